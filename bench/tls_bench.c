@@ -0,0 +1,285 @@
+// Loopback load generator for the viewer transport (src/tls_transport.c).
+//
+// The real server needs a PipeWire session and serves one MJPEG viewer at a
+// time, so this drives the transport directly: a forked server process streams
+// synthetic frames to N viewers with the exact write pattern of
+// handle_mjpeg_client() (boundary header + JPEG with MSG_MORE, then CRLF), one
+// thread per viewer. The parent runs N reader threads that only decrypt and
+// discard. Server and readers are separate processes, so the CPU reported for
+// the server is the transport cost alone.
+//
+//   ./tls_bench --mode plain|tls|ktls --viewers N [--fps F] [--seconds S]
+//               [--frame-kb K] [--cert cert.pem --key key.pem]
+//
+// --fps 0 (default) streams as fast as possible to measure throughput; a
+// fixed rate such as --fps 60 gives the CPU cost of each viewer.
+
+#include "tls_transport.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <openssl/err.h>
+
+#define READ_BUFFER_SIZE (256 * 1024)
+
+typedef struct {
+    int server_fd;
+    int fps;
+    int seconds;
+    size_t frame_size;
+    const uint8_t *frame;
+    pthread_barrier_t *start;
+    unsigned long frames_sent;
+    int ktls_tx;
+} ViewerWorker;
+
+typedef struct {
+    struct sockaddr_in address;
+    int use_tls;
+    unsigned long long bytes_read;
+} ViewerReader;
+
+static SSL_CTX *client_ctx = NULL;
+
+static double elapsed_sec(const struct timespec *a, const struct timespec *b) {
+    return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+static double cpu_sec(int who) {
+    struct rusage usage;
+    getrusage(who, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static void *stream_viewer(void *arg) {
+    ViewerWorker *w = arg;
+    ClientConn conn;
+
+    int fd = accept(w->server_fd, NULL, NULL);
+    if (fd < 0 || conn_accept(&conn, fd, 5) < 0) {
+        perror("bench accept");
+        exit(EXIT_FAILURE);
+    }
+    conn_set_timeout(&conn, 0);
+    w->ktls_tx = conn.ktls_tx;
+
+    pthread_barrier_wait(w->start);
+
+    struct timespec start, next, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    next = start;
+    long interval_ns = w->fps > 0 ? 1000000000L / w->fps : 0;
+
+    char frame_header[256];
+    int header_len = snprintf(frame_header, sizeof(frame_header),
+                              "--myboundary\r\n"
+                              "Content-Type: image/jpeg\r\n"
+                              "Content-Length: %zu\r\n\r\n",
+                              w->frame_size);
+
+    while (1) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (elapsed_sec(&start, &now) >= w->seconds) break;
+
+        if (conn_send_all(&conn, frame_header, header_len, MSG_MORE) < 0 ||
+            conn_send_all(&conn, w->frame, w->frame_size, MSG_MORE) < 0 ||
+            conn_send_all(&conn, "\r\n", 2, 0) < 0) {
+            fprintf(stderr, "bench viewer disconnected\n");
+            break;
+        }
+        w->frames_sent++;
+
+        if (interval_ns) {
+            next.tv_nsec += interval_ns;
+            while (next.tv_nsec >= 1000000000L) {
+                next.tv_nsec -= 1000000000L;
+                next.tv_sec++;
+            }
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        }
+    }
+
+    conn_close(&conn);
+    return NULL;
+}
+
+static void *read_viewer(void *arg) {
+    ViewerReader *r = arg;
+    uint8_t *buffer = malloc(READ_BUFFER_SIZE);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (!buffer || fd < 0 || connect(fd, (struct sockaddr *)&r->address, sizeof(r->address)) < 0) {
+        perror("bench connect");
+        exit(EXIT_FAILURE);
+    }
+
+    if (r->use_tls) {
+        SSL *ssl = SSL_new(client_ctx);
+        SSL_set_fd(ssl, fd);
+        if (SSL_connect(ssl) != 1) {
+            ERR_print_errors_fp(stderr);
+            exit(EXIT_FAILURE);
+        }
+        size_t n;
+        while (SSL_read_ex(ssl, buffer, READ_BUFFER_SIZE, &n) == 1) {
+            r->bytes_read += n;
+        }
+        SSL_free(ssl);
+    } else {
+        ssize_t n;
+        while ((n = read(fd, buffer, READ_BUFFER_SIZE)) > 0) {
+            r->bytes_read += n;
+        }
+    }
+
+    close(fd);
+    free(buffer);
+    return NULL;
+}
+
+static void run_server(int server_fd, int viewers, int fps, int seconds, size_t frame_size) {
+    uint8_t *frame = malloc(frame_size);
+    ViewerWorker *workers = calloc(viewers, sizeof(ViewerWorker));
+    pthread_t *threads = calloc(viewers, sizeof(pthread_t));
+    pthread_barrier_t start;
+    if (!frame || !workers || !threads) exit(EXIT_FAILURE);
+
+    // JPEG data is incompressible; random bytes keep any path from cheating
+    srand(1);
+    for (size_t i = 0; i < frame_size; i++) frame[i] = rand();
+
+    pthread_barrier_init(&start, NULL, viewers + 1);
+    for (int i = 0; i < viewers; i++) {
+        workers[i] = (ViewerWorker){server_fd, fps, seconds, frame_size, frame, &start, 0, 0};
+        pthread_create(&threads[i], NULL, stream_viewer, &workers[i]);
+    }
+
+    pthread_barrier_wait(&start);
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    double cpu0 = cpu_sec(RUSAGE_SELF);
+
+    unsigned long frames = 0;
+    int ktls = 0;
+    for (int i = 0; i < viewers; i++) {
+        pthread_join(threads[i], NULL);
+        frames += workers[i].frames_sent;
+        ktls += workers[i].ktls_tx;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double wall = elapsed_sec(&t0, &t1);
+    double cpu = cpu_sec(RUSAGE_SELF) - cpu0;
+
+    printf("server: %d viewers (%d with kTLS TX), %.1f fps/viewer, %.0f MB/s total\n", viewers, ktls,
+           frames / wall / viewers, frames * (double)frame_size / wall / 1e6);
+    printf("server: CPU %.1f%% of a core total, %.1f%% per viewer, %.1f us per frame\n", 100 * cpu / wall,
+           100 * cpu / wall / viewers, frames ? cpu / frames * 1e6 : 0.0);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s --mode plain|tls|ktls [--viewers N] [--fps F] [--seconds S] [--frame-kb K] "
+            "[--cert cert.pem --key key.pem]\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    const char *mode = "plain";
+    const char *cert = "cert.pem";
+    const char *key = "key.pem";
+    int viewers = 1, fps = 0, seconds = 5, frame_kb = 250;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        if (strcmp(argv[i], "--mode") == 0) {
+            mode = argv[++i];
+        } else if (strcmp(argv[i], "--viewers") == 0) {
+            viewers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--fps") == 0) {
+            fps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seconds") == 0) {
+            seconds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--frame-kb") == 0) {
+            frame_kb = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cert") == 0) {
+            cert = argv[++i];
+        } else if (strcmp(argv[i], "--key") == 0) {
+            key = argv[++i];
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    int use_tls = strcmp(mode, "plain") != 0;
+    if ((use_tls && strcmp(mode, "tls") != 0 && strcmp(mode, "ktls") != 0) || viewers < 1 || fps < 0 ||
+        seconds < 1 || frame_kb < 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address = {0};
+    socklen_t addrlen = sizeof(address);
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(server_fd, viewers) < 0 ||
+        getsockname(server_fd, (struct sockaddr *)&address, &addrlen) < 0) {
+        perror("bench listen");
+        return EXIT_FAILURE;
+    }
+
+    pid_t server = fork();
+    if (server == 0) {
+        if (use_tls && init_tls(cert, key, strcmp(mode, "ktls") == 0) < 0) _exit(EXIT_FAILURE);
+        run_server(server_fd, viewers, fps, seconds, (size_t)frame_kb * 1024);
+        fflush(stdout);
+        _exit(EXIT_SUCCESS);
+    }
+    close(server_fd);
+
+    if (use_tls) {
+        client_ctx = SSL_CTX_new(TLS_client_method());
+        SSL_CTX_set_read_ahead(client_ctx, 1);
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    ViewerReader *readers = calloc(viewers, sizeof(ViewerReader));
+    pthread_t *threads = calloc(viewers, sizeof(pthread_t));
+    for (int i = 0; i < viewers; i++) {
+        readers[i] = (ViewerReader){address, use_tls, 0};
+        pthread_create(&threads[i], NULL, read_viewer, &readers[i]);
+    }
+
+    unsigned long long total = 0;
+    for (int i = 0; i < viewers; i++) {
+        pthread_join(threads[i], NULL);
+        total += readers[i].bytes_read;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    int status = 0;
+    waitpid(server, &status, 0);
+
+    // A reader near 100% of a core means it, not the server, set the pace
+    double wall = elapsed_sec(&t0, &t1);
+    printf("readers: %.1f MB received, CPU %.1f%% of a core per reader\n", total / 1e6,
+           100 * cpu_sec(RUSAGE_SELF) / wall / viewers);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+}
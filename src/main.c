@@ -7,18 +7,21 @@
 #include "wayland_capture.h"
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <signal.h>
 
 #include "mjpeg_stream.h"
+#include "tls_transport.h"
 
 #define PORT 8080
 #define BUFFER_SIZE 8192
+#define REQUEST_TIMEOUT_SEC 5
 
-void send_file(int client_socket, const char *filepath, const char *content_type) {
+void send_file(ClientConn *conn, const char *filepath, const char *content_type) {
     int file_fd = open(filepath, O_RDONLY);
     if (file_fd < 0) {
         perror("Failed to open file");
         const char *not_found = "HTTP/1.1 404 Not Found\r\nConnection: close\r\n\r\n404 Not Found";
-        send(client_socket, not_found, strlen(not_found), 0);
+        conn_send_all(conn, not_found, strlen(not_found), 0);
         return;
     }
 
@@ -34,21 +37,18 @@ void send_file(int client_socket, const char *filepath, const char *content_type
              "Connection: close\r\n\r\n",
              content_type, file_size);
 
-    send(client_socket, header, strlen(header), 0);
-
-    char file_buffer[BUFFER_SIZE];
-    ssize_t bytes_read;
-    while ((bytes_read = read(file_fd, file_buffer, sizeof(file_buffer))) > 0) {
-        send(client_socket, file_buffer, bytes_read, 0);
+    // sendfile() keeps the file out of user space; under kTLS the kernel still encrypts it into its own buffer
+    // Only cork the header when a body follows: an open kTLS record is dropped, not flushed, on close.
+    if (conn_send_all(conn, header, strlen(header), file_size > 0 ? MSG_MORE : 0) == 0 && file_size > 0) {
+        conn_sendfile_all(conn, file_fd, file_size);
     }
 
     close(file_fd);
 }
 
-void handle_request(int client_socket, char *request) {
+void handle_request(ClientConn *conn, char *request) {
     char method[16], path[256];
     if (sscanf(request, "%15s %255s", method, path) != 2) {
-        close(client_socket);
         return;
     }
 
@@ -56,21 +56,53 @@ void handle_request(int client_socket, char *request) {
 
     if (strcmp(method, "GET") == 0) {
         if (strcmp(path, "/") == 0 || strcmp(path, "/index.html") == 0) {
-            send_file(client_socket, "client/index.html", "text/html");
+            send_file(conn, "client/index.html", "text/html");
         } else if (strcmp(path, "/stream.mjpeg") == 0) {
-            handle_mjpeg_client(client_socket);
+            handle_mjpeg_client(conn);
             // After the loop breaks, we let the main logic close the socket or it will close upstream.
         } else {
             const char *not_found = "HTTP/1.1 404 Not Found\r\nConnection: close\r\n\r\nFile Not Found";
-            send(client_socket, not_found, strlen(not_found), 0);
+            conn_send_all(conn, not_found, strlen(not_found), 0);
         }
     }
 }
 
-int main() {
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--tls-cert cert.pem --tls-key key.pem [--no-ktls]]\n", prog);
+}
+
+int main(int argc, char **argv) {
     setbuf(stdout, NULL);
     setbuf(stderr, NULL);
-    
+
+    // Disconnected viewers must not kill the server from inside sendfile()/SSL_write()
+    signal(SIGPIPE, SIG_IGN);
+
+    const char *tls_cert = NULL;
+    const char *tls_key = NULL;
+    int use_ktls = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--tls-cert") == 0 && i + 1 < argc) {
+            tls_cert = argv[++i];
+        } else if (strcmp(argv[i], "--tls-key") == 0 && i + 1 < argc) {
+            tls_key = argv[++i];
+        } else if (strcmp(argv[i], "--no-ktls") == 0) {
+            use_ktls = 0;
+        } else {
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if ((tls_cert == NULL) != (tls_key == NULL)) {
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (tls_cert && init_tls(tls_cert, tls_key, use_ktls) < 0) {
+        exit(EXIT_FAILURE);
+    }
+
     int server_fd, new_socket;
     struct sockaddr_in address;
     int opt = 1;
@@ -107,7 +139,7 @@ int main() {
     // Initialize Wayland connection before accepting web connections.
     init_wayland_capture();
 
-    printf("Server listening on port %d...\n", PORT);
+    printf("Server listening on port %d (%s)...\n", PORT, tls_enabled() ? "https" : "http");
 
     while(1) {
         if ((new_socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t*)&addrlen)) < 0) {
@@ -115,13 +147,21 @@ int main() {
             continue;
         }
 
+        ClientConn conn;
+        // The accept loop is single-threaded: bound the handshake and request read
+        if (conn_accept(&conn, new_socket, REQUEST_TIMEOUT_SEC) < 0) {
+            close(new_socket);
+            continue;
+        }
+
         memset(buffer, 0, BUFFER_SIZE);
-        int valread = read(new_socket, buffer, BUFFER_SIZE - 1);
+        ssize_t valread = conn_read(&conn, buffer, BUFFER_SIZE - 1);
         if (valread > 0) {
-            handle_request(new_socket, buffer);
+            conn_set_timeout(&conn, 0);
+            handle_request(&conn, buffer);
         }
-        
-        close(new_socket);
+
+        conn_close(&conn);
     }
 
     return 0;
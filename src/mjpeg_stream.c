@@ -1,4 +1,5 @@
 #include "mjpeg_stream.h"
+#include "tls_transport.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -56,19 +57,7 @@ void update_latest_frame(const uint8_t *bgra_pixels, int width, int height, int
     tjDestroy(_jpegCompressor);
 }
 
-// Helper para garantir que 100% dos bytes da imagem vão chegar via TCP, mesmo em gargalos de Wi-Fi
-static int send_all(int socket, const void *buffer, size_t length) {
-    size_t bytes_sent = 0;
-    const uint8_t *ptr = buffer;
-    while (bytes_sent < length) {
-        ssize_t res = send(socket, ptr + bytes_sent, length - bytes_sent, MSG_NOSIGNAL);
-        if (res <= 0) return -1;
-        bytes_sent += res;
-    }
-    return 0;
-}
-
-void handle_mjpeg_client(int client_socket) {
+void handle_mjpeg_client(ClientConn *conn) {
     const char *header = 
         "HTTP/1.1 200 OK\r\n"
         "Cache-Control: no-cache, private\r\n"
@@ -76,7 +65,7 @@ void handle_mjpeg_client(int client_socket) {
         "Content-Type: multipart/x-mixed-replace; boundary=--myboundary\r\n"
         "Connection: close\r\n\r\n";
     
-    if (send_all(client_socket, header, strlen(header)) < 0) {
+    if (conn_send_all(conn, header, strlen(header), 0) < 0) {
         return;
     }
 
@@ -113,18 +102,18 @@ void handle_mjpeg_client(int client_socket) {
                  "Content-Length: %lu\r\n\r\n", 
                  local_size);
 
-        // Send Boundary Header
-        if (send_all(client_socket, frame_header, header_len) < 0) {
+        // Send Boundary Header. MSG_MORE folds it and the trailing CRLF into the JPEG's segments/TLS records.
+        if (conn_send_all(conn, frame_header, header_len, MSG_MORE) < 0) {
             break; // Client disconnected
         }
 
         // Send JPEG Bytes
-        if (send_all(client_socket, local_buffer, local_size) < 0) {
+        if (conn_send_all(conn, local_buffer, local_size, MSG_MORE) < 0) {
             break; // Client disconnected
         }
         
-        // Send trailing CRLF for the multipart spec
-        if (send_all(client_socket, "\r\n", 2) < 0) {
+        // Send trailing CRLF for the multipart spec, flushing the frame
+        if (conn_send_all(conn, "\r\n", 2, 0) < 0) {
             break;
         }
     }
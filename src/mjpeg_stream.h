@@ -5,6 +5,9 @@
 #include <stddef.h>
 #include <pthread.h>
 
+// Defined in tls_transport.h
+typedef struct ClientConn ClientConn;
+
 // Global state holding the latest compressed JPEG frame
 typedef struct {
     uint8_t *jpeg_buffer;
@@ -22,6 +25,6 @@ void init_mjpeg_stream();
 void update_latest_frame(const uint8_t *bgra_pixels, int width, int height, int stride);
 
 // Logic to keep a TCP connection alive sending the boundary multipart continuously
-void handle_mjpeg_client(int client_socket);
+void handle_mjpeg_client(ClientConn *conn);
 
 #endif // MJPEG_STREAM_H
@@ -0,0 +1,213 @@
+#include "tls_transport.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/sendfile.h>
+#include <openssl/err.h>
+
+static SSL_CTX *tls_ctx = NULL;
+
+int init_tls(const char *cert_path, const char *key_path, int use_ktls) {
+    tls_ctx = SSL_CTX_new(TLS_server_method());
+    if (!tls_ctx) {
+        ERR_print_errors_fp(stderr);
+        return -1;
+    }
+
+    SSL_CTX_set_min_proto_version(tls_ctx, TLS1_2_VERSION);
+
+    // OpenSSL performs the handshake in user space and, once the traffic keys
+    // are known, installs them on the socket with setsockopt(TCP_ULP, "tls").
+    if (use_ktls) {
+        SSL_CTX_set_options(tls_ctx, SSL_OP_ENABLE_KTLS);
+    }
+
+    if (SSL_CTX_use_certificate_chain_file(tls_ctx, cert_path) != 1 ||
+        SSL_CTX_use_PrivateKey_file(tls_ctx, key_path, SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(tls_ctx) != 1) {
+        fprintf(stderr, "Failed to load TLS certificate/key (%s, %s)\n", cert_path, key_path);
+        ERR_print_errors_fp(stderr);
+        SSL_CTX_free(tls_ctx);
+        tls_ctx = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+int tls_enabled() {
+    return tls_ctx != NULL;
+}
+
+void conn_set_timeout(ClientConn *conn, int seconds) {
+    struct timeval tv = {.tv_sec = seconds, .tv_usec = 0};
+    setsockopt(conn->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(conn->fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+int conn_accept(ClientConn *conn, int fd, int timeout_sec) {
+    conn->fd = fd;
+    conn->ssl = NULL;
+    conn->ktls_tx = 0;
+    conn->fatal = 0;
+    conn->pending = NULL;
+    conn->pending_len = 0;
+    conn_set_timeout(conn, timeout_sec);
+
+    if (!tls_ctx) {
+        return 0;
+    }
+
+    ERR_clear_error();
+    SSL *ssl = SSL_new(tls_ctx);
+    if (!ssl || SSL_set_fd(ssl, fd) != 1 || SSL_accept(ssl) != 1) {
+        fprintf(stderr, "TLS handshake failed or timed out\n");
+        ERR_print_errors_fp(stderr);
+        SSL_free(ssl);
+        return -1;
+    }
+
+    conn->ssl = ssl;
+    conn->ktls_tx = BIO_get_ktls_send(SSL_get_wbio(ssl)) ? 1 : 0;
+    if (!conn->ktls_tx) {
+        conn->pending = malloc(TLS_RECORD_SIZE);
+        if (!conn->pending) {
+            SSL_free(ssl);
+            conn->ssl = NULL;
+            return -1;
+        }
+    }
+
+    printf("TLS %s (%s), record encryption in %s\n", SSL_get_version(ssl), SSL_get_cipher_name(ssl),
+           conn->ktls_tx ? "kernel" : "user space");
+    return 0;
+}
+
+// OpenSSL forbids SSL_shutdown() after SSL_ERROR_SYSCALL or SSL_ERROR_SSL
+static void note_ssl_error(ClientConn *conn, int res) {
+    int err = SSL_get_error(conn->ssl, res);
+    if (err == SSL_ERROR_SYSCALL || err == SSL_ERROR_SSL) {
+        conn->fatal = 1;
+    }
+}
+
+ssize_t conn_read(ClientConn *conn, void *buffer, size_t length) {
+    if (conn->ssl) {
+        ERR_clear_error();
+        int res = SSL_read(conn->ssl, buffer, (int)length);
+        if (res <= 0) {
+            note_ssl_error(conn, res);
+            return -1;
+        }
+        return res;
+    }
+    return read(conn->fd, buffer, length);
+}
+
+static int ssl_write_all(ClientConn *conn, const uint8_t *ptr, size_t length) {
+    while (length > 0) {
+        size_t written = 0;
+        ERR_clear_error();
+        int res = SSL_write_ex(conn->ssl, ptr, length, &written);
+        if (res != 1) {
+            note_ssl_error(conn, res);
+            return -1;
+        }
+        ptr += written;
+        length -= written;
+    }
+    return 0;
+}
+
+static int flush_pending(ClientConn *conn) {
+    if (conn->pending_len == 0) return 0;
+    int res = ssl_write_all(conn, conn->pending, conn->pending_len);
+    conn->pending_len = 0;
+    return res;
+}
+
+int conn_send_all(ClientConn *conn, const void *buffer, size_t length, int flags) {
+    const uint8_t *ptr = buffer;
+
+    // User-space TLS: every SSL_write() ends a record, so MSG_MORE data is
+    // collected until it fills a record or a call without MSG_MORE arrives.
+    if (conn->ssl && !conn->ktls_tx) {
+        while (length > 0) {
+            if (conn->pending_len == 0 && length >= TLS_RECORD_SIZE) {
+                // Whole records go straight from the caller's buffer
+                size_t direct = length - length % TLS_RECORD_SIZE;
+                if (ssl_write_all(conn, ptr, direct) < 0) return -1;
+                ptr += direct;
+                length -= direct;
+                continue;
+            }
+
+            size_t take = TLS_RECORD_SIZE - conn->pending_len;
+            if (take > length) take = length;
+            memcpy(conn->pending + conn->pending_len, ptr, take);
+            conn->pending_len += take;
+            ptr += take;
+            length -= take;
+
+            if (conn->pending_len == TLS_RECORD_SIZE && flush_pending(conn) < 0) return -1;
+        }
+        return (flags & MSG_MORE) ? 0 : flush_pending(conn);
+    }
+
+    // Plaintext or kTLS: the kernel takes the bytes as they are.
+    size_t bytes_sent = 0;
+    while (bytes_sent < length) {
+        ssize_t res = send(conn->fd, ptr + bytes_sent, length - bytes_sent, flags | MSG_NOSIGNAL);
+        if (res <= 0) {
+            conn->fatal = 1;
+            return -1;
+        }
+        bytes_sent += res;
+    }
+    return 0;
+}
+
+int conn_sendfile_all(ClientConn *conn, int file_fd, size_t count) {
+    if (conn->ssl && !conn->ktls_tx) {
+        uint8_t chunk[TLS_RECORD_SIZE];
+        size_t remaining = count;
+        while (remaining > 0) {
+            ssize_t bytes_read = read(file_fd, chunk, remaining < sizeof(chunk) ? remaining : sizeof(chunk));
+            if (bytes_read <= 0) return -1;
+            remaining -= bytes_read;
+            if (conn_send_all(conn, chunk, bytes_read, remaining > 0 ? MSG_MORE : 0) < 0) return -1;
+        }
+        return 0;
+    }
+
+    off_t offset = 0;
+    while ((size_t)offset < count) {
+        ssize_t res = sendfile(conn->fd, file_fd, &offset, count - offset);
+        if (res < 0) {
+            conn->fatal = 1;
+            return -1;
+        }
+        if (res == 0) return -1; // File shrank under us
+    }
+    return 0;
+}
+
+void conn_close(ClientConn *conn) {
+    if (conn->ssl) {
+        if (!conn->fatal) {
+            flush_pending(conn);
+        }
+        if (!conn->fatal) {
+            ERR_clear_error();
+            SSL_shutdown(conn->ssl);
+        }
+        SSL_free(conn->ssl);
+        conn->ssl = NULL;
+    }
+    free(conn->pending);
+    conn->pending = NULL;
+    close(conn->fd);
+}
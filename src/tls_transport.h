@@ -0,0 +1,55 @@
+#ifndef TLS_TRANSPORT_H
+#define TLS_TRANSPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <openssl/ssl.h>
+
+#define TLS_RECORD_SIZE 16384 // Largest plaintext fragment a TLS record carries
+
+// One HTTP viewer connection. When kernel TLS owns the transmit path, the SSL
+// object is only kept for the handshake and close_notify: every write goes
+// straight to fd with send()/sendfile() and the kernel builds the records.
+typedef struct ClientConn {
+    int fd;
+    SSL *ssl;    // NULL for plain HTTP
+    int ktls_tx; // 1 when the kernel encrypts everything written to fd
+    int fatal;   // 1 after an I/O error: no close_notify may be sent any more
+    uint8_t *pending;   // User-space TLS only: plaintext held back by MSG_MORE
+    size_t pending_len; // Never reaches TLS_RECORD_SIZE, full records are written out
+} ClientConn;
+
+// Load the certificate/key pair and switch the server to HTTPS.
+// With use_ktls = 0 records are always encrypted in user space (SSL_write).
+// Returns 0 on success and -1 on error.
+int init_tls(const char *cert_path, const char *key_path, int use_ktls);
+
+// Returns 1 when init_tls() succeeded and connections are served over HTTPS.
+int tls_enabled();
+
+// Wrap an accepted socket, running the TLS handshake if HTTPS is enabled.
+// The socket gets a timeout of timeout_sec for both directions so a silent
+// peer cannot stall the accept loop; clear it with conn_set_timeout(conn, 0)
+// once the request has been read. Returns 0 on success and -1 if the
+// handshake failed (fd is left open).
+int conn_accept(ClientConn *conn, int fd, int timeout_sec);
+
+// Set SO_RCVTIMEO/SO_SNDTIMEO on the socket, 0 meaning block forever.
+void conn_set_timeout(ClientConn *conn, int seconds);
+
+ssize_t conn_read(ClientConn *conn, void *buffer, size_t length);
+
+// Write the whole buffer. flags may carry MSG_MORE so that small headers are
+// coalesced with the following body instead of going out as tiny TCP segments
+// or TLS records. The user-space TLS path emulates this by buffering.
+int conn_send_all(ClientConn *conn, const void *buffer, size_t length, int flags);
+
+// Stream count bytes of file_fd from its start, using sendfile() whenever the
+// socket carries plaintext or kTLS.
+int conn_sendfile_all(ClientConn *conn, int file_fd, size_t count);
+
+// Send close_notify (if TLS), release the SSL object and close the socket.
+void conn_close(ClientConn *conn);
+
+#endif // TLS_TRANSPORT_H